@@ -37,12 +37,51 @@
 //--------------------------------------------------------------------
 
 #include "nomjson.h"
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#ifdef NOMJSON_USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef NOMJSON_USE_ZSTD
+#include <zstd.h>
+#endif
 //#define TRACE
 #include "trace.h"
 
 namespace njson
 {
 
+// Number of bytes the scanner requests from an input source at a time,
+// and the size of each decompressed chunk handed between threads.
+const size_t kInputChunkSize = 64 * 1024;
+
+// Maximum number of decompressed chunks that may be waiting for the
+// parser at any one time.  This bounds the memory used by streaming
+// decompression regardless of the decompressed size of the input.
+const size_t kMaxQueuedChunks = 4;
+
+//--------------------------------------------------------------------
+// Interface for a source of raw JSON text that is delivered to the
+// scanner a piece at a time (e.g. from a file or a decompressor),
+// rather than all at once in a memory buffer.
+//--------------------------------------------------------------------
+class JsonInputSource
+{
+public:
+   virtual ~JsonInputSource() = default;
+
+   //--------------------------------------------------------------------
+   // Copies up to maxCount bytes of input into the given buffer.
+   // Returns the number of bytes copied, or zero at end of input.
+   // Errors throw.
+   //--------------------------------------------------------------------
+   virtual size_t Read(char *buffer, size_t maxCount) = 0;
+};
+
 //--------------------------------------------------------------------
 // Class to handle tokenizing of a string of JSON text.
 //--------------------------------------------------------------------
@@ -62,17 +101,58 @@ public:
    {
       trace("JsonScanner constructing indata=%p incount=%zu\n", indata, incount);
 
+      m_source = nullptr;
+      m_rewindable = true;
       m_indata.clear();
       m_indata.insert(m_indata.end(), indata, indata + incount);
+      m_inpos = 0;
+      m_inbase = 0;
+      m_token.clear();
+      ScanNextToken();
+   }
+
+   //--------------------------------------------------------------------
+   // Begins tokenizing JSON text that is pulled from the given source
+   // as it is needed.  Only a chunk or so of the input is held in
+   // memory at a time once DisableRewind() has been called.
+   // The source must remain valid until tokenizing is finished.
+   // Errors throw.
+   //--------------------------------------------------------------------
+   void Start(JsonInputSource &source)
+   {
+      trace("JsonScanner constructing source=%p\n", &source);
+
+      m_source = &source;
+      m_rewindable = true;
+      m_indata.clear();
+      m_inpos = 0;
+      m_inbase = 0;
+      m_token.clear();
+      ScanNextToken();
+   }
+
+   //--------------------------------------------------------------------
+   // Restarts tokenizing from the beginning of the input.  Only valid
+   // until DisableRewind() is called.
+   //--------------------------------------------------------------------
+   void Rewind()
+   {
       m_inpos = 0;
       m_token.clear();
       ScanNextToken();
    }
 
+   //--------------------------------------------------------------------
+   // Allows input that has already been tokenized to be discarded
+   // when more input is read from the source.  After this is called,
+   // Rewind() may no longer be used.
+   //--------------------------------------------------------------------
+   void DisableRewind() { m_rewindable = false; }
+
    //--------------------------------------------------------------------
    // Stops tokenizing.  Any allocated memory is freed.
    //--------------------------------------------------------------------
-   void Stop() { m_indata.clear(); m_inpos = 0; m_token.clear(); }
+   void Stop() { m_indata.clear(); m_inpos = 0; m_inbase = 0; m_token.clear(); m_source = nullptr; }
 
    //--------------------------------------------------------------------
    // Given the character that follows a backslash in a JSON file,
@@ -102,7 +182,7 @@ public:
    {
       m_token.clear();
       m_quote = ' ';
-      size_t startingPos = m_inpos;
+      size_t startingPos = m_inbase + m_inpos;
 
       // Skip leading whitespace.
       while (iswspace(CurChar()))
@@ -158,7 +238,7 @@ public:
       // empty and still valid.  For example, when two quotes in
       // the JSON text have nothing inside "" then the corresponding
       // token is an empty string.
-      return (m_inpos != startingPos);
+      return (m_inbase + m_inpos != startingPos);
    }
 
    //--------------------------------------------------------------------
@@ -185,7 +265,7 @@ public:
    // Returns true if all of the JSON input has been tokenized (no more
    // tokens left).
    //--------------------------------------------------------------------
-   bool EndOfInput() { return (m_inpos >= m_indata.size()); }
+   bool EndOfInput() { return (m_inpos >= m_indata.size() && !Refill()); }
 
 private:
    //--------------------------------------------------------------------
@@ -194,13 +274,47 @@ private:
    //--------------------------------------------------------------------
    char CurChar()
    {
-      if (m_inpos >= m_indata.size())
+      if (m_inpos >= m_indata.size() && !Refill())
          return '\0';
       return m_indata[m_inpos];
    }
 
+   //--------------------------------------------------------------------
+   // Appends the next chunk of input from the source (if any) to the
+   // input buffer, first discarding the input that has already been
+   // tokenized unless the scanner is still rewindable.  Returns false
+   // if there is no more input.
+   //--------------------------------------------------------------------
+   bool Refill()
+   {
+      if (m_source == nullptr)
+         return false;
+
+      if (!m_rewindable)
+      {
+         m_indata.erase(m_indata.begin(), m_indata.begin() + m_inpos);
+         m_inbase += m_inpos;
+         m_inpos = 0;
+      }
+
+      size_t oldSize = m_indata.size();
+      m_indata.resize(oldSize + kInputChunkSize);
+      size_t count = m_source->Read(&m_indata[oldSize], kInputChunkSize);
+      m_indata.resize(oldSize + count);
+      if (count == 0)
+         m_source = nullptr;   // Don't ask the source again after it runs dry.
+
+      trace("JsonScanner refilled %zu bytes\n", count);
+      return (count != 0);
+   }
+
+   JsonInputSource  *m_source = nullptr;  // Where more JSON text comes from, if
+                                          // it isn't all in m_indata already.
+   bool              m_rewindable = true; // If true, don't discard consumed input.
    std::vector<char> m_indata;      // The JSON text currently being parsed.
    size_t            m_inpos = 0;   // The current position in the JSON text.
+   size_t            m_inbase = 0;  // Offset of m_indata[0] from the start of
+                                    // the input, after discarding consumed text.
    std::wstring      m_token;       // The current token from the JSON text.
    char              m_quote = ' '; // If the token was quoted, this contains
                                     // the kind of quote it was quoted with
@@ -336,28 +450,24 @@ std::shared_ptr<JsonNode> ParseJSONNode(JsonScanner &lex, bool noNamePrefix)
    return std::make_shared<JsonNode>(node);
 }
 
-} // End anon namespace
-
 //--------------------------------------------------------------------
-// Parses JSON text from the given memory buffer.
-// If successful, the root node of the node tree is returned.
-// Errors throw.
+// Parses the JSON or JSONP text that the given scanner has just been
+// started on.  If successful, the root node of the node tree is
+// returned.  Errors throw.
 //--------------------------------------------------------------------
-std::shared_ptr<JsonNode> ParseJSONFromMemory(const char *data, size_t size)
+std::shared_ptr<JsonNode> ParseJSONFromScanner(JsonScanner &lex)
 {
-   trace("ParseJSONFromMemory data=%p size=%zu\n", data, size);
-
-   JsonScanner lex;
-
    // Determine if the input data is in JSON or JSONP format.
    // If the second token is a left parenthesis, assume it's JSONP.
-   lex.Start(data, size);
    lex.ScanNextToken();       // Eat the jsonp function name.
    bool formatJSONP = lex.TokenIs(L"(");
    if (formatJSONP)
       lex.ScanNextToken();    // Eat the "("
    else
-      lex.Start(data, size);  // Restart for regular JSON, not JSONP.
+      lex.Rewind();           // Restart for regular JSON, not JSONP.
+
+   // From here on the scanner is free to discard input it's done with.
+   lex.DisableRewind();
 
    trace("formatJSONP=%c\n", formatJSONP ? 'Y' : 'N');
 
@@ -372,55 +482,1712 @@ std::shared_ptr<JsonNode> ParseJSONFromMemory(const char *data, size_t size)
 }
 
 //--------------------------------------------------------------------
-// Overload of above, takes vector of chars.
+// Input source that reads raw bytes from an open file.  The file is
+// closed when the source is destroyed.
 //--------------------------------------------------------------------
-std::shared_ptr<JsonNode> ParseJSONFromMemory(const std::vector<char> &data)
+class FileInputSource : public JsonInputSource
 {
-   if (data.empty())
-      return nullptr;
+public:
+   explicit FileInputSource(FILE *file) : m_file(file) {}
+   FileInputSource(const FileInputSource &f) = delete;
+   ~FileInputSource() { fclose(m_file); }
 
-   return ParseJSONFromMemory(data.data(), data.size());
-}
+   size_t Read(char *buffer, size_t maxCount) override
+   {
+      size_t count = fread(buffer, 1, maxCount, m_file);
+      if (count == 0 && ferror(m_file))
+         throw std::wstring(L"Failed reading data from file");
+      return count;
+   }
+
+private:
+   FILE *m_file;
+};
 
+#ifdef NOMJSON_USE_ZLIB
 //--------------------------------------------------------------------
-// Parses JSON text from the specified file.
-// If successful, the root node of the node tree is returned.
-// Errors throw.
+// Input source that decompresses gzip data read from another source.
+// Concatenated gzip members are decompressed one after another.
 //--------------------------------------------------------------------
-std::shared_ptr<JsonNode> ParseJSONFromFile(const std::wstring &filename)
+class GzipInputSource : public JsonInputSource
 {
-   trace(L"ParseJSONFromFile filename='%s'\n", filename.c_str());
+public:
+   explicit GzipInputSource(std::unique_ptr<JsonInputSource> compressed) :
+      m_compressed(std::move(compressed)),
+      m_inbuf(kInputChunkSize)
+   {
+      // Window bits of 15+16 selects gzip format with the largest window.
+      if (inflateInit2(&m_zs, 15 + 16) != Z_OK)
+         throw std::wstring(L"Failed initializing gzip decompressor");
+   }
+   GzipInputSource(const GzipInputSource &g) = delete;
+   ~GzipInputSource() { inflateEnd(&m_zs); }
 
-   std::vector<char> data;
+   size_t Read(char *buffer, size_t maxCount) override
+   {
+      m_zs.next_out = reinterpret_cast<Bytef *>(buffer);
+      m_zs.avail_out = static_cast<uInt>(maxCount);
 
-   FILE *file = nullptr;
-   if (_wfopen_s(&file, filename.c_str(), L"rb") || file == nullptr)
-      throw L"File could not be opened for reading";
+      while (m_zs.avail_out == maxCount)
+      {
+         if (m_zs.avail_in == 0)
+         {
+            m_zs.next_in = m_inbuf.data();
+            m_zs.avail_in = static_cast<uInt>(
+               m_compressed->Read(reinterpret_cast<char *>(m_inbuf.data()), m_inbuf.size()));
+            if (m_zs.avail_in == 0)
+            {
+               if (!m_memberDone)
+                  throw std::wstring(L"Compressed file is truncated");
+               break;   // End of input.
+            }
+         }
 
-   try
+         // If the previous gzip member ended and there's more data,
+         // another member follows it.
+         if (m_memberDone)
+         {
+            inflateReset(&m_zs);
+            m_memberDone = false;
+         }
+
+         int status = inflate(&m_zs, Z_NO_FLUSH);
+         if (status == Z_STREAM_END)
+            m_memberDone = true;
+         else if (status != Z_OK && status != Z_BUF_ERROR)
+            throw std::wstring(L"Compressed file is corrupt (gzip)");
+      }
+
+      return maxCount - m_zs.avail_out;
+   }
+
+private:
+   std::unique_ptr<JsonInputSource> m_compressed;  // Where the gzip data comes from.
+   std::vector<Bytef> m_inbuf;      // Compressed data waiting to be inflated.
+   z_stream     m_zs = {};          // State of the zlib decompressor.
+   bool         m_memberDone = false; // True if at the end of a gzip member.
+};
+#endif // NOMJSON_USE_ZLIB
+
+#ifdef NOMJSON_USE_ZSTD
+//--------------------------------------------------------------------
+// Input source that decompresses Zstandard data read from another
+// source.  Concatenated zstd frames are decompressed one after another.
+//--------------------------------------------------------------------
+class ZstdInputSource : public JsonInputSource
+{
+public:
+   explicit ZstdInputSource(std::unique_ptr<JsonInputSource> compressed) :
+      m_compressed(std::move(compressed)),
+      m_inbuf(ZSTD_DStreamInSize())
+   {
+      m_zs = ZSTD_createDStream();
+      if (m_zs == nullptr)
+         throw std::wstring(L"Failed initializing zstd decompressor");
+   }
+   ZstdInputSource(const ZstdInputSource &z) = delete;
+   ~ZstdInputSource() { ZSTD_freeDStream(m_zs); }
+
+   size_t Read(char *buffer, size_t maxCount) override
    {
-      fseek(file, 0, SEEK_END);
-      long fileSize = ftell(file);
-      fseek(file, 0, SEEK_SET);
-      if (fileSize < 1)
-         throw L"File is empty";
+      ZSTD_outBuffer out = { buffer, maxCount, 0 };
 
-      trace("File size is %ld\n", fileSize);
+      while (out.pos == 0)
+      {
+         if (m_in.pos >= m_in.size)
+         {
+            m_in.src = m_inbuf.data();
+            m_in.size = m_compressed->Read(m_inbuf.data(), m_inbuf.size());
+            m_in.pos = 0;
+            if (m_in.size == 0)
+            {
+               if (!m_frameDone)
+                  throw std::wstring(L"Compressed file is truncated");
+               break;   // End of input.
+            }
+         }
 
-      data.resize(fileSize);
-      if (fread(&data[0], fileSize, 1, file) != 1)
-         throw L"Failed reading data from file";
+         size_t status = ZSTD_decompressStream(m_zs, &out, &m_in);
+         if (ZSTD_isError(status))
+            throw std::wstring(L"Compressed file is corrupt (zstd)");
+         m_frameDone = (status == 0);
+      }
 
-      fclose(file);
+      return out.pos;
    }
-   catch(...)
+
+private:
+   std::unique_ptr<JsonInputSource> m_compressed;  // Where the zstd data comes from.
+   std::vector<char> m_inbuf;       // Compressed data waiting to be decompressed.
+   ZSTD_inBuffer     m_in = { nullptr, 0, 0 }; // Unused portion of m_inbuf.
+   ZSTD_DStream     *m_zs = nullptr;           // State of the zstd decompressor.
+   bool              m_frameDone = true;       // True if between zstd frames.
+};
+#endif // NOMJSON_USE_ZSTD
+
+//--------------------------------------------------------------------
+// Input source that reads another source on a background thread, so
+// that the work of reading (e.g. decompressing) overlaps with the
+// work of parsing.  At most kMaxQueuedChunks chunks are read ahead.
+//--------------------------------------------------------------------
+class ThreadedInputSource : public JsonInputSource
+{
+public:
+   explicit ThreadedInputSource(std::unique_ptr<JsonInputSource> source) :
+      m_source(std::move(source)),
+      m_thread(&ThreadedInputSource::ReadAhead, this)
    {
-      fclose(file);
-      throw;
    }
+   ThreadedInputSource(const ThreadedInputSource &t) = delete;
 
-   // This does most of the work.
-   return ParseJSONFromMemory(data);
+   ~ThreadedInputSource()
+   {
+      {
+         std::lock_guard<std::mutex> lock(m_mutex);
+         m_stop = true;
+      }
+      m_cond.notify_all();
+      m_thread.join();
+   }
+
+   size_t Read(char *buffer, size_t maxCount) override
+   {
+      // Move on to the next queued chunk when the current one is used up.
+      if (m_chunkPos >= m_chunk.size())
+      {
+         std::unique_lock<std::mutex> lock(m_mutex);
+         m_cond.wait(lock, [this] { return !m_queue.empty() || m_done; });
+         if (m_queue.empty())
+         {
+            if (!m_error.empty())
+               throw m_error;
+            return 0;   // End of input.
+         }
+         m_chunk.swap(m_queue.front());
+         m_queue.pop_front();
+         m_chunkPos = 0;
+         lock.unlock();
+         m_cond.notify_all();
+      }
+
+      size_t count = std::min(maxCount, m_chunk.size() - m_chunkPos);
+      memcpy(buffer, &m_chunk[m_chunkPos], count);
+      m_chunkPos += count;
+      return count;
+   }
+
+private:
+   //--------------------------------------------------------------------
+   // Runs on the background thread.  Reads chunks from the source into
+   // the queue until the source runs dry or the reader goes away.
+   //--------------------------------------------------------------------
+   void ReadAhead()
+   {
+      try
+      {
+         for (;;)
+         {
+            std::vector<char> chunk(kInputChunkSize);
+            size_t count = m_source->Read(chunk.data(), chunk.size());
+            if (count == 0)
+               break;
+            chunk.resize(count);
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this] { return m_queue.size() < kMaxQueuedChunks || m_stop; });
+            if (m_stop)
+               return;
+            m_queue.push_back(std::move(chunk));
+            lock.unlock();
+            m_cond.notify_all();
+         }
+      }
+      catch(const std::wstring &exc)
+      {
+         std::lock_guard<std::mutex> lock(m_mutex);
+         m_error = exc;
+      }
+      catch(...)
+      {
+         std::lock_guard<std::mutex> lock(m_mutex);
+         m_error = L"Failed reading data from file";
+      }
+
+      {
+         std::lock_guard<std::mutex> lock(m_mutex);
+         m_done = true;
+      }
+      m_cond.notify_all();
+   }
+
+   std::unique_ptr<JsonInputSource> m_source;   // The source being read ahead.
+   std::deque<std::vector<char>>    m_queue;    // Chunks read but not yet consumed.
+   std::vector<char>        m_chunk;            // Chunk currently being consumed.
+   size_t                   m_chunkPos = 0;     // Position within m_chunk.
+   std::wstring             m_error;            // Error from the background thread.
+   bool                     m_done = false;     // True when background thread is finished.
+   bool                     m_stop = false;     // True when the reader wants it to stop.
+   std::mutex               m_mutex;            // Guards the members shared between threads.
+   std::condition_variable  m_cond;             // Signals changes to the queue.
+   std::thread              m_thread;           // The background thread.  Must be last.
+};
+
+// Maximum nesting depth of arrays and groups accepted by Validate().
+const size_t kMaxValidateDepth = 1024;
+
+//--------------------------------------------------------------------
+// Class to check JSON text for well-formedness without building a
+// node tree.  Works directly on the caller's buffer, and keeps track
+// of nesting in a fixed-size array, so nothing is allocated.
+//--------------------------------------------------------------------
+class JsonValidator
+{
+public:
+   JsonValidator(const char *data, size_t size, JsonSyntax syntax) :
+      m_data(data), m_pos(data), m_end(data + size),
+      m_lenient(syntax == JsonSyntax::Lenient)
+   {
+   }
+   JsonValidator(const JsonValidator &j) = delete;
+   ~JsonValidator() = default;
+
+   //--------------------------------------------------------------------
+   // Checks the entire input.  Returns the result.
+   //--------------------------------------------------------------------
+   JsonValidateResult Run()
+   {
+      JsonValidateResult result;
+
+      if (!CheckDocument())
+      {
+         result.m_valid = false;
+         result.m_error = m_error;
+         result.m_offset = static_cast<size_t>(m_pos - m_data);
+
+         // Line and column are only worked out on failure, to keep
+         // the scanning loops as tight as possible.
+         result.m_line = 1;
+         result.m_column = 1;
+         for (const char *p = m_data; p < m_pos; ++p)
+         {
+            if (*p == '\n')
+            {
+               ++result.m_line;
+               result.m_column = 1;
+            }
+            else
+            {
+               ++result.m_column;
+            }
+         }
+      }
+
+      return result;
+   }
+
+private:
+   //--------------------------------------------------------------------
+   // Records an error at the current position.  Always returns false.
+   //--------------------------------------------------------------------
+   bool Fail(const wchar_t *error)
+   {
+      m_error = error;
+      return false;
+   }
+
+   //--------------------------------------------------------------------
+   // Returns the current character, or '\0' at the end of the input.
+   // Check AtEnd() to tell the end apart from an embedded nul.
+   //--------------------------------------------------------------------
+   char CurChar() const { return (m_pos < m_end) ? *m_pos : '\0'; }
+   bool AtEnd() const { return (m_pos >= m_end); }
+
+   //--------------------------------------------------------------------
+   // Skips JSON whitespace (space, tab, CR, LF).
+   //--------------------------------------------------------------------
+   void SkipSpace()
+   {
+      while (m_pos < m_end &&
+             (*m_pos == ' ' || *m_pos == '\n' || *m_pos == '\r' || *m_pos == '\t'))
+         ++m_pos;
+   }
+
+   //--------------------------------------------------------------------
+   // Checks the document as a whole:  a single value surrounded by
+   // optional whitespace, or (if lenient) a JSONP function call
+   // wrapped around a single value.
+   //--------------------------------------------------------------------
+   bool CheckDocument()
+   {
+      SkipSpace();
+      if (AtEnd())
+         return Fail(L"Input is empty");
+
+      // If lenient and the text starts with a JavaScript identifier
+      // that isn't a literal, assume it's the name of a JSONP function.
+      bool formatJSONP = false;
+      const char *start = m_pos;
+      bool literal = MatchLiteral("true") || MatchLiteral("false") || MatchLiteral("null");
+      m_pos = start;
+      if (m_lenient && IsIdentStart(CurChar()) && !literal)
+      {
+         while (m_pos < m_end && IsIdentChar(*m_pos))
+            ++m_pos;
+         SkipSpace();
+         if (CurChar() != '(')
+            return Fail(L"Expected '(' after JSONP function name");
+         ++m_pos;
+         formatJSONP = true;
+      }
+
+      if (!CheckValue())
+         return false;
+
+      SkipSpace();
+      if (formatJSONP)
+      {
+         if (CurChar() != ')')
+            return Fail(L"Missing right parenthesis at end of JSONP function");
+         ++m_pos;
+         SkipSpace();
+         if (CurChar() == ';')
+         {
+            ++m_pos;
+            SkipSpace();
+         }
+      }
+
+      if (!AtEnd())
+         return Fail(L"Unexpected text after end of JSON value");
+      return true;
+   }
+
+   //--------------------------------------------------------------------
+   // Checks one complete value, including any nested arrays and groups.
+   // Nesting is handled with an explicit stack rather than recursion.
+   //--------------------------------------------------------------------
+   bool CheckValue()
+   {
+      size_t depth = 0;
+
+      for (;;)
+      {
+         // Expecting a value here.
+         SkipSpace();
+         char c = CurChar();
+         if (c == '{' || c == '[')
+         {
+            if (depth >= kMaxValidateDepth)
+               return Fail(L"Arrays or groups are nested too deeply");
+            m_stack[depth++] = c;
+            ++m_pos;
+            SkipSpace();
+
+            // Unless it's empty, go on to the first element.
+            if (CurChar() != (c == '{' ? '}' : ']'))
+            {
+               if (c == '{' && !CheckMemberName())
+                  return false;
+               continue;
+            }
+            ++m_pos;
+            --depth;
+         }
+         else if (!CheckScalar())
+         {
+            return false;
+         }
+
+         // Finished a value.  Close any arrays or groups that end here,
+         // then move on to the next element of the innermost one.
+         for (;;)
+         {
+            if (depth == 0)
+               return true;
+
+            char close = (m_stack[depth - 1] == '{') ? '}' : ']';
+            SkipSpace();
+            bool comma = (CurChar() == ',');
+            if (comma)
+            {
+               ++m_pos;
+               SkipSpace();
+            }
+
+            if (CurChar() == close)
+            {
+               if (comma && !m_lenient)
+                  return Fail(L"Trailing comma after last element");
+               ++m_pos;
+               --depth;
+               continue;
+            }
+
+            if (AtEnd())
+               return Fail(L"Unexpected end of input inside array or group");
+            if (!comma && !m_lenient)
+               return Fail(L"Expected comma between elements");
+            if (close == '}' && !CheckMemberName())
+               return false;
+            break;
+         }
+      }
+   }
+
+   //--------------------------------------------------------------------
+   // Checks the name of a group member and the colon that follows it.
+   //--------------------------------------------------------------------
+   bool CheckMemberName()
+   {
+      char c = CurChar();
+      if (c != '"' && !(c == '\'' && m_lenient))
+         return Fail(L"Expected quoted name of group member");
+      if (!CheckString())
+         return false;
+      SkipSpace();
+      if (CurChar() != ':')
+         return Fail(L"JSON malformed:  Colon missing between object name and value");
+      ++m_pos;
+      return true;
+   }
+
+   //--------------------------------------------------------------------
+   // Checks a string, number, or literal value.
+   //--------------------------------------------------------------------
+   bool CheckScalar()
+   {
+      char c = CurChar();
+      if (c == '"' || (c == '\'' && m_lenient))
+         return CheckString();
+      if (c == '-' || (c >= '0' && c <= '9'))
+         return CheckNumber();
+      if (MatchLiteral("true") || MatchLiteral("false") || MatchLiteral("null"))
+         return true;
+      if (AtEnd())
+         return Fail(L"Unexpected end of input, expected a value");
+      return Fail(L"Expected a value");
+   }
+
+   //--------------------------------------------------------------------
+   // If the given literal word is next, skips it and returns true.
+   //--------------------------------------------------------------------
+   bool MatchLiteral(const char *word)
+   {
+      const char *p = m_pos;
+      for (; *word; ++word, ++p)
+         if (p >= m_end || *p != *word)
+            return false;
+
+      // Don't match just the start of a longer identifier.
+      if (p < m_end && IsIdentChar(*p))
+         return false;
+      m_pos = p;
+      return true;
+   }
+
+   //--------------------------------------------------------------------
+   // Checks a number per the RFC 8259 grammar:
+   //    [ '-' ] ( '0' | [1-9][0-9]* ) [ '.' [0-9]+ ] [ [eE] [+-] [0-9]+ ]
+   //--------------------------------------------------------------------
+   bool CheckNumber()
+   {
+      if (CurChar() == '-')
+         ++m_pos;
+
+      if (CurChar() == '0')
+         ++m_pos;
+      else if (!SkipDigits())
+         return Fail(L"Malformed number:  Missing digits");
+
+      if (CurChar() == '.')
+      {
+         ++m_pos;
+         if (!SkipDigits())
+            return Fail(L"Malformed number:  Missing digits after decimal point");
+      }
+
+      if (CurChar() == 'e' || CurChar() == 'E')
+      {
+         ++m_pos;
+         if (CurChar() == '+' || CurChar() == '-')
+            ++m_pos;
+         if (!SkipDigits())
+            return Fail(L"Malformed number:  Missing digits in exponent");
+      }
+
+      if (m_pos < m_end && (IsIdentChar(*m_pos) || *m_pos == '.'))
+         return Fail(L"Malformed number");
+      return true;
+   }
+
+   //--------------------------------------------------------------------
+   // Skips decimal digits.  Returns false if there were none.
+   //--------------------------------------------------------------------
+   bool SkipDigits()
+   {
+      const char *start = m_pos;
+      while (m_pos < m_end && *m_pos >= '0' && *m_pos <= '9')
+         ++m_pos;
+      return (m_pos != start);
+   }
+
+   //--------------------------------------------------------------------
+   // Checks a quoted string, including its escape sequences and the
+   // UTF-8 encoding of any non-ASCII characters.
+   //--------------------------------------------------------------------
+   bool CheckString()
+   {
+      char quote = *m_pos++;
+
+      for (;;)
+      {
+         // Fast path for runs of plain ASCII characters.
+         while (m_pos < m_end)
+         {
+            unsigned char c = static_cast<unsigned char>(*m_pos);
+            if (c < 0x20 || c >= 0x80 || c == '\\' || c == static_cast<unsigned char>(quote))
+               break;
+            ++m_pos;
+         }
+
+         if (AtEnd())
+            return Fail(L"Unterminated string");
+
+         unsigned char c = static_cast<unsigned char>(*m_pos);
+         if (c == static_cast<unsigned char>(quote))
+         {
+            ++m_pos;
+            return true;
+         }
+         if (c == '\\')
+         {
+            if (!CheckEscape(quote))
+               return false;
+         }
+         else if (c < 0x20)
+         {
+            return Fail(L"Control character in string must be escaped");
+         }
+         else if (!CheckUTF8())
+         {
+            return false;
+         }
+      }
+   }
+
+   //--------------------------------------------------------------------
+   // Checks a backslash escape sequence within a string.
+   //--------------------------------------------------------------------
+   bool CheckEscape(char quote)
+   {
+      ++m_pos;    // Skip the backslash.
+      char c = CurChar();
+      switch (c)
+      {
+         case '"': case '\\': case '/':
+         case 'b': case 'f': case 'n': case 'r': case 't':
+            ++m_pos;
+            return true;
+         case 'u':
+            ++m_pos;
+            for (int ndx = 0; ndx < 4; ++ndx, ++m_pos)
+               if (!IsHexDigit(CurChar()))
+                  return Fail(L"Malformed \\u escape in string");
+            return true;
+      }
+
+      // Single-quoted strings may also escape the single quote.
+      if (c == '\'' && quote == '\'')
+      {
+         ++m_pos;
+         return true;
+      }
+      if (AtEnd())
+         return Fail(L"Unterminated string");
+      return Fail(L"Invalid escape sequence in string");
+   }
+
+   //--------------------------------------------------------------------
+   // Checks one multi-byte UTF-8 sequence (RFC 3629), rejecting
+   // overlong forms, surrogates, and code points above U+10FFFF.
+   //--------------------------------------------------------------------
+   bool CheckUTF8()
+   {
+      unsigned char c = static_cast<unsigned char>(*m_pos);
+      size_t count = 0;
+      unsigned char lo = 0x80, hi = 0xBF;  // Range of the second byte.
+
+      if (c >= 0xC2 && c <= 0xDF)
+      {
+         count = 1;
+      }
+      else if (c >= 0xE0 && c <= 0xEF)
+      {
+         count = 2;
+         if (c == 0xE0)
+            lo = 0xA0;     // Overlong.
+         else if (c == 0xED)
+            hi = 0x9F;     // Surrogates.
+      }
+      else if (c >= 0xF0 && c <= 0xF4)
+      {
+         count = 3;
+         if (c == 0xF0)
+            lo = 0x90;     // Overlong.
+         else if (c == 0xF4)
+            hi = 0x8F;     // Above U+10FFFF.
+      }
+      else
+      {
+         return Fail(L"Invalid UTF-8 in string");
+      }
+
+      if (static_cast<size_t>(m_end - m_pos) <= count)
+         return Fail(L"Truncated UTF-8 sequence in string");
+
+      const unsigned char *p = reinterpret_cast<const unsigned char *>(m_pos) + 1;
+      if (p[0] < lo || p[0] > hi)
+         return Fail(L"Invalid UTF-8 in string");
+      for (size_t ndx = 1; ndx < count; ++ndx)
+         if (p[ndx] < 0x80 || p[ndx] > 0xBF)
+            return Fail(L"Invalid UTF-8 in string");
+
+      m_pos += count + 1;
+      return true;
+   }
+
+   static bool IsHexDigit(char c)
+   {
+      return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+   }
+   static bool IsIdentStart(char c)
+   {
+      return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '$';
+   }
+   static bool IsIdentChar(char c)
+   {
+      return IsIdentStart(c) || (c >= '0' && c <= '9') || c == '.';
+   }
+
+   const char    *m_data;             // Start of the JSON text.
+   const char    *m_pos;              // Current position in the JSON text.
+   const char    *m_end;              // End of the JSON text.
+   bool           m_lenient;          // True to accept the parser's extensions.
+   const wchar_t *m_error = nullptr;  // Description of the first error found.
+   char           m_stack[kMaxValidateDepth]; // Open '[' or '{' for each nesting level.
+};
+
+//--------------------------------------------------------------------
+// Opens the specified JSON file for streaming into the scanner,
+// arranging for it to be decompressed if necessary.
+// Errors throw.
+//--------------------------------------------------------------------
+std::unique_ptr<JsonInputSource> OpenJSONFile(const std::wstring &filename)
+{
+   FILE *file = nullptr;
+   if (_wfopen_s(&file, filename.c_str(), L"rb") || file == nullptr)
+      throw std::wstring(L"File could not be opened for reading");
+   std::unique_ptr<JsonInputSource> source(new FileInputSource(file));
+
+   // Check for the magic number of a compressed file format.
+   unsigned char magic[4] = { 0, 0, 0, 0 };
+   size_t magicSize = fread(magic, 1, sizeof(magic), file);
+   fseek(file, 0, SEEK_SET);
+   if (magicSize < 1)
+      throw std::wstring(L"File is empty");
+
+   bool isGzip = (magicSize >= 2 && magic[0] == 0x1F && magic[1] == 0x8B);
+   bool isZstd = (magicSize >= 4 && magic[0] == 0x28 && magic[1] == 0xB5 &&
+                  magic[2] == 0x2F && magic[3] == 0xFD);
+
+   trace("isGzip=%c isZstd=%c\n", isGzip ? 'Y' : 'N', isZstd ? 'Y' : 'N');
+
+   // Compressed files are decompressed a chunk at a time on a
+   // background thread while the parser consumes the output.
+   if (isGzip)
+   {
+#ifdef NOMJSON_USE_ZLIB
+      source.reset(new GzipInputSource(std::move(source)));
+      source.reset(new ThreadedInputSource(std::move(source)));
+#else
+      throw std::wstring(L"File is gzip compressed, but gzip support is not enabled");
+#endif
+   }
+   else if (isZstd)
+   {
+#ifdef NOMJSON_USE_ZSTD
+      source.reset(new ZstdInputSource(std::move(source)));
+      source.reset(new ThreadedInputSource(std::move(source)));
+#else
+      throw std::wstring(L"File is zstd compressed, but zstd support is not enabled");
+#endif
+   }
+
+   return source;
+}
+
+//--------------------------------------------------------------------
+// State shared between ParseJSONBatch and its worker threads.
+// Item N's result waits in slot N % m_slots.size() until it has been
+// handed to the caller, and a worker won't start an item until its
+// slot is free.  That is what bounds the number of documents in
+// flight.
+//--------------------------------------------------------------------
+class JsonBatch
+{
+public:
+   JsonBatch(const std::vector<JsonBatchItem> &items, size_t maxInFlight) :
+      m_items(items), m_slots(maxInFlight), m_ready(maxInFlight, false)
+   {
+   }
+   JsonBatch(const JsonBatch &j) = delete;
+   ~JsonBatch() = default;
+
+   //--------------------------------------------------------------------
+   // Body of each worker thread.  Parses items until there are none
+   // left or the batch is abandoned.
+   //--------------------------------------------------------------------
+   void Worker()
+   {
+      // Each worker has its own scanner, so the scanner's buffers are
+      // reused from one document to the next instead of reallocated.
+      JsonScanner lex;
+
+      for (;;)
+      {
+         size_t index = 0;
+         {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this] {
+               return m_stop || m_nextItem >= m_items.size() ||
+                      m_nextItem < m_nextResult + m_slots.size();
+            });
+            if (m_stop || m_nextItem >= m_items.size())
+               return;
+            index = m_nextItem++;
+         }
+
+         JsonBatchResult result;
+         ParseItem(lex, m_items[index], result);
+
+         {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_slots[index % m_slots.size()] = std::move(result);
+            m_ready[index % m_slots.size()] = true;
+         }
+         m_cond.notify_all();
+      }
+   }
+
+   //--------------------------------------------------------------------
+   // Runs on the calling thread.  Hands each result to the callback
+   // in input order as it becomes ready.
+   //--------------------------------------------------------------------
+   void Deliver(const std::function<void(size_t, JsonBatchResult &)> &callback)
+   {
+      for (size_t index = 0; index < m_items.size(); ++index)
+      {
+         size_t slot = index % m_slots.size();
+         JsonBatchResult result;
+         {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this, slot] { return m_ready[slot]; });
+            result = std::move(m_slots[slot]);
+            m_slots[slot] = JsonBatchResult();
+            m_ready[slot] = false;
+         }
+
+         callback(index, result);
+
+         {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_nextResult;   // Frees the slot for another item.
+         }
+         m_cond.notify_all();
+      }
+   }
+
+   //--------------------------------------------------------------------
+   // Tells the workers to stop as soon as they finish their current item.
+   //--------------------------------------------------------------------
+   void Abandon()
+   {
+      {
+         std::lock_guard<std::mutex> lock(m_mutex);
+         m_stop = true;
+      }
+      m_cond.notify_all();
+   }
+
+private:
+   //--------------------------------------------------------------------
+   // Parses one item with the given scanner.  Errors are stored in
+   // the result rather than thrown.
+   //--------------------------------------------------------------------
+   static void ParseItem(JsonScanner &lex, const JsonBatchItem &item, JsonBatchResult &result)
+   {
+      try
+      {
+         if (!item.m_filename.empty())
+         {
+            auto source = OpenJSONFile(item.m_filename);
+            lex.Start(*source);
+            result.m_root = ParseJSONFromScanner(lex);
+         }
+         else
+         {
+            lex.Start(item.m_data, item.m_size);
+            result.m_root = ParseJSONFromScanner(lex);
+         }
+
+         if (!result.m_root)
+            result.m_error = L"Input is empty";
+      }
+      catch(const std::wstring &exc)
+      {
+         result.m_error = exc;
+      }
+      catch(...)
+      {
+         result.m_error = L"Unexpected error while parsing";
+      }
+   }
+
+   const std::vector<JsonBatchItem> &m_items;   // The items to parse.
+   std::vector<JsonBatchResult> m_slots;        // Results not yet handed to the caller.
+   std::vector<bool>        m_ready;            // Which slots hold a finished result.
+   size_t                   m_nextItem = 0;     // Index of the next item to parse.
+   size_t                   m_nextResult = 0;   // Index of the next result to hand over.
+   bool                     m_stop = false;     // True if the batch was abandoned.
+   std::mutex               m_mutex;            // Guards all of the above.
+   std::condition_variable  m_cond;             // Signals changes to the above.
+};
+
+//--------------------------------------------------------------------
+// Splits a JSON Pointer (RFC 6901) into its reference tokens,
+// replacing the escapes "~1" and "~0" with "/" and "~".
+// Returns false if the pointer is malformed.
+//--------------------------------------------------------------------
+bool SplitJSONPointer(const std::wstring &pointer, std::vector<std::wstring> &tokens)
+{
+   tokens.clear();
+   if (pointer.empty())
+      return true;
+   if (pointer[0] != L'/')
+      return false;
+
+   for (size_t ndx = 1; ; ++ndx)
+   {
+      tokens.emplace_back();
+      for (; ndx < pointer.size() && pointer[ndx] != L'/'; ++ndx)
+      {
+         wchar_t c = pointer[ndx];
+         if (c == L'~')
+         {
+            wchar_t next = (ndx + 1 < pointer.size()) ? pointer[++ndx] : L'\0';
+            if (next == L'0')
+               c = L'~';
+            else if (next == L'1')
+               c = L'/';
+            else
+               return false;
+         }
+         tokens.back() += c;
+      }
+      if (ndx >= pointer.size())
+         return true;
+   }
+}
+
+//--------------------------------------------------------------------
+// Converts a JSON Pointer reference token to an array index.
+// Returns false if the token isn't a valid array index (digits only,
+// with no leading zeros).
+//--------------------------------------------------------------------
+bool ArrayIndexFromToken(const std::wstring &token, size_t &index)
+{
+   if (token.empty() || token.size() > 18 || (token[0] == L'0' && token.size() > 1))
+      return false;
+
+   index = 0;
+   for (wchar_t c : token)
+   {
+      if (c < L'0' || c > L'9')
+         return false;
+      index = index * 10 + (c - L'0');
+   }
+   return true;
+}
+
+//--------------------------------------------------------------------
+// Finds the child of the given node that a JSON Pointer reference
+// token refers to.  Returns null pointer if there is no such child.
+//--------------------------------------------------------------------
+std::shared_ptr<JsonNode> FindChildByToken(JsonNode &node, const std::wstring &token)
+{
+   if (node.m_type == JsonType::Group)
+      return node.FindChildByName(token);
+
+   size_t index = 0;
+   if (node.m_type == JsonType::Array && ArrayIndexFromToken(token, index) &&
+       index < node.m_children.size())
+      return node.m_children[index];
+
+   return nullptr;
+}
+
+//--------------------------------------------------------------------
+// Makes a deep copy of the given node and its children.
+//--------------------------------------------------------------------
+std::shared_ptr<JsonNode> CloneJSONNode(const JsonNode &node)
+{
+   auto copy = std::make_shared<JsonNode>();
+   copy->m_name = node.m_name;
+   copy->m_type = node.m_type;
+   copy->m_string = node.m_string;
+   copy->m_number = node.m_number;
+   copy->m_bool = node.m_bool;
+   copy->m_children.reserve(node.m_children.size());
+   for (const auto &child : node.m_children)
+      copy->m_children.push_back(CloneJSONNode(*child));
+   return copy;
+}
+
+//--------------------------------------------------------------------
+// Returns the index of the first child of the given node with the
+// given name, or -1 if there is none.
+//--------------------------------------------------------------------
+size_t IndexOfChildName(const JsonNode &node, const std::wstring &name)
+{
+   for (size_t ndx = 0; ndx < node.m_children.size(); ++ndx)
+      if (node.m_children[ndx]->m_name == name)
+         return ndx;
+   return static_cast<size_t>(-1);
+}
+
+//--------------------------------------------------------------------
+// Returns true if the two nodes have equal values, per the rules of
+// the JSON Patch "test" operation.  The nodes' own names are ignored,
+// and the order of group members doesn't matter.
+//--------------------------------------------------------------------
+bool JSONNodesEqual(const JsonNode &a, const JsonNode &b)
+{
+   if (a.m_type != b.m_type || a.m_children.size() != b.m_children.size())
+      return false;
+
+   switch (a.m_type)
+   {
+      case JsonType::Number:  return a.m_number == b.m_number;
+      case JsonType::String:  return a.m_string == b.m_string;
+      case JsonType::Bool:    return a.m_bool == b.m_bool;
+      case JsonType::Null:    return true;
+      case JsonType::Array:
+         for (size_t ndx = 0; ndx < a.m_children.size(); ++ndx)
+            if (!JSONNodesEqual(*a.m_children[ndx], *b.m_children[ndx]))
+               return false;
+         return true;
+      case JsonType::Group:
+         for (const auto &child : a.m_children)
+         {
+            size_t ndx = IndexOfChildName(b, child->m_name);
+            if (ndx == static_cast<size_t>(-1) || !JSONNodesEqual(*child, *b.m_children[ndx]))
+               return false;
+         }
+         return true;
+   }
+   return false;
+}
+
+//--------------------------------------------------------------------
+// Class to apply JSON Patch and JSON Merge Patch changes to a tree of
+// JSON nodes.  Every change is recorded in an undo log, so that if a
+// later change fails, Rollback() can put the tree back the way it was
+// without having had to copy it beforehand.
+//--------------------------------------------------------------------
+class JsonPatcher
+{
+public:
+   explicit JsonPatcher(std::shared_ptr<JsonNode> &root) : m_root(root) {}
+   JsonPatcher(const JsonPatcher &j) = delete;
+   ~JsonPatcher() = default;
+
+   //--------------------------------------------------------------------
+   // Applies one JSON Patch (RFC 6902) operation.  Errors throw.
+   //--------------------------------------------------------------------
+   void ApplyOperation(const JsonNode &op)
+   {
+      if (op.m_type != JsonType::Group)
+         throw std::wstring(L"JSON Patch operation is not a group");
+
+      const std::wstring &name = GetMemberString(op, L"op");
+      std::vector<std::wstring> path;
+      GetMemberPointer(op, L"path", path);
+
+      trace(L"JsonPatcher op='%s'\n", name.c_str());
+
+      if (name == L"add")
+      {
+         Add(path, CloneJSONNode(GetMember(op, L"value")));
+      }
+      else if (name == L"remove")
+      {
+         Remove(path);
+      }
+      else if (name == L"replace")
+      {
+         Replace(path, CloneJSONNode(GetMember(op, L"value")));
+      }
+      else if (name == L"move")
+      {
+         std::vector<std::wstring> from;
+         GetMemberPointer(op, L"from", from);
+         if (from == path)
+            return;
+         if (from.size() < path.size() && std::equal(from.begin(), from.end(), path.begin()))
+            throw std::wstring(L"JSON Patch can't move a value into one of its own children");
+         Add(path, Remove(from));
+      }
+      else if (name == L"copy")
+      {
+         std::vector<std::wstring> from;
+         GetMemberPointer(op, L"from", from);
+         Add(path, CloneJSONNode(*Find(from)));
+      }
+      else if (name == L"test")
+      {
+         if (!JSONNodesEqual(*Find(path), GetMember(op, L"value")))
+            throw std::wstring(L"JSON Patch test operation failed");
+      }
+      else
+      {
+         throw std::wstring(L"Unknown JSON Patch operation");
+      }
+   }
+
+   //--------------------------------------------------------------------
+   // Applies a JSON Merge Patch (RFC 7396) to the root.
+   //--------------------------------------------------------------------
+   void ApplyMergePatch(const JsonNode &patch)
+   {
+      if (patch.m_type != JsonType::Group)
+      {
+         SetRoot(CloneJSONNode(patch));
+         return;
+      }
+
+      if (!m_root || m_root->m_type != JsonType::Group)
+         SetRoot(NewGroup());
+      MergeGroup(m_root, patch);
+   }
+
+   //--------------------------------------------------------------------
+   // Undoes all of the changes made so far, most recent first.
+   //--------------------------------------------------------------------
+   void Rollback()
+   {
+      while (!m_undo.empty())
+      {
+         m_undo.back()();
+         m_undo.pop_back();
+      }
+   }
+
+private:
+   //--------------------------------------------------------------------
+   // Merges the members of a merge patch group into the target group.
+   //--------------------------------------------------------------------
+   void MergeGroup(const std::shared_ptr<JsonNode> &target, const JsonNode &patch)
+   {
+      for (const auto &member : patch.m_children)
+      {
+         size_t ndx = IndexOfChildName(*target, member->m_name);
+         bool exists = (ndx != static_cast<size_t>(-1));
+
+         // Null means remove the member.
+         if (member->m_type == JsonType::Null)
+         {
+            if (exists)
+               DetachChild(target, ndx);
+            continue;
+         }
+
+         // A group is merged into an existing group member.
+         if (member->m_type == JsonType::Group && exists &&
+             target->m_children[ndx]->m_type == JsonType::Group)
+         {
+            MergeGroup(target->m_children[ndx], *member);
+            continue;
+         }
+
+         // Anything else replaces the member (or adds it).  A group is
+         // merged into a new empty group, which drops any nulls in it.
+         std::shared_ptr<JsonNode> value;
+         if (member->m_type == JsonType::Group)
+         {
+            value = NewGroup();
+            MergeGroup(value, *member);
+         }
+         else
+         {
+            value = CloneJSONNode(*member);
+         }
+
+         if (exists)
+            DetachChild(target, ndx);
+         else
+            ndx = target->m_children.size();
+         AttachChild(target, ndx, value, member->m_name);
+      }
+   }
+
+   //--------------------------------------------------------------------
+   // JSON Patch "add":  Inserts the node into an array, or adds it to
+   // (or replaces it in) a group, or replaces the root.
+   //--------------------------------------------------------------------
+   void Add(const std::vector<std::wstring> &path, const std::shared_ptr<JsonNode> &node)
+   {
+      if (path.empty())
+      {
+         SetRoot(node);
+         return;
+      }
+
+      auto parent = FindParent(path);
+      const std::wstring &key = path.back();
+      if (parent->m_type == JsonType::Group)
+      {
+         size_t ndx = IndexOfChildName(*parent, key);
+         if (ndx != static_cast<size_t>(-1))
+            DetachChild(parent, ndx);
+         else
+            ndx = parent->m_children.size();
+         AttachChild(parent, ndx, node, key);
+      }
+      else
+      {
+         size_t ndx = parent->m_children.size();
+         if (key != L"-" && (!ArrayIndexFromToken(key, ndx) || ndx > parent->m_children.size()))
+            throw std::wstring(L"JSON Patch array index is out of range");
+         AttachChild(parent, ndx, node, std::wstring());
+      }
+   }
+
+   //--------------------------------------------------------------------
+   // JSON Patch "remove":  Removes the node and returns it.
+   //--------------------------------------------------------------------
+   std::shared_ptr<JsonNode> Remove(const std::vector<std::wstring> &path)
+   {
+      if (path.empty())
+         throw std::wstring(L"JSON Patch can't remove the root");
+
+      auto parent = FindParent(path);
+      return DetachChild(parent, FindIndex(*parent, path.back()));
+   }
+
+   //--------------------------------------------------------------------
+   // JSON Patch "replace":  Replaces an existing node, keeping its place.
+   //--------------------------------------------------------------------
+   void Replace(const std::vector<std::wstring> &path, const std::shared_ptr<JsonNode> &node)
+   {
+      if (path.empty())
+      {
+         if (!m_root)
+            throw std::wstring(L"JSON Patch path not found");
+         SetRoot(node);
+         return;
+      }
+
+      auto parent = FindParent(path);
+      size_t ndx = FindIndex(*parent, path.back());
+      std::wstring name = parent->m_children[ndx]->m_name;
+      DetachChild(parent, ndx);
+      AttachChild(parent, ndx, node, name);
+   }
+
+   //--------------------------------------------------------------------
+   // Returns the node at the given path.  Throws if there is none.
+   //--------------------------------------------------------------------
+   std::shared_ptr<JsonNode> Find(const std::vector<std::wstring> &path)
+   {
+      auto node = m_root;
+      for (const auto &token : path)
+      {
+         if (!node)
+            break;
+         node = FindChildByToken(*node, token);
+      }
+      if (!node)
+         throw std::wstring(L"JSON Patch path not found");
+      return node;
+   }
+
+   //--------------------------------------------------------------------
+   // Returns the array or group that holds the node at the given path.
+   // Throws if there is none.
+   //--------------------------------------------------------------------
+   std::shared_ptr<JsonNode> FindParent(const std::vector<std::wstring> &path)
+   {
+      std::vector<std::wstring> parentPath(path.begin(), path.end() - 1);
+      auto parent = Find(parentPath);
+      if (parent->m_type != JsonType::Group && parent->m_type != JsonType::Array)
+         throw std::wstring(L"JSON Patch path's parent is not an array or group");
+      return parent;
+   }
+
+   //--------------------------------------------------------------------
+   // Returns the index of the parent's child named by the given
+   // reference token.  Throws if there is none.
+   //--------------------------------------------------------------------
+   static size_t FindIndex(const JsonNode &parent, const std::wstring &token)
+   {
+      size_t ndx = static_cast<size_t>(-1);
+      if (parent.m_type == JsonType::Group)
+         ndx = IndexOfChildName(parent, token);
+      else if (!ArrayIndexFromToken(token, ndx) || ndx >= parent.m_children.size())
+         ndx = static_cast<size_t>(-1);
+
+      if (ndx == static_cast<size_t>(-1))
+         throw std::wstring(L"JSON Patch path not found");
+      return ndx;
+   }
+
+   //--------------------------------------------------------------------
+   // The primitive changes to the tree.  Each records how to undo itself.
+   //--------------------------------------------------------------------
+   void SetRoot(const std::shared_ptr<JsonNode> &node)
+   {
+      auto oldRoot = m_root;
+      std::wstring oldName = node->m_name;
+      m_undo.push_back([this, oldRoot, node, oldName] {
+         m_root = oldRoot;
+         node->m_name = oldName;
+      });
+      node->m_name.clear();   // The root has no name.
+      m_root = node;
+   }
+
+   void AttachChild(const std::shared_ptr<JsonNode> &parent, size_t ndx,
+                    const std::shared_ptr<JsonNode> &node, const std::wstring &name)
+   {
+      // The undo step is only recorded once the insert has succeeded,
+      // so that undoing a failed insert can't erase some other child.
+      std::wstring oldName = node->m_name;
+      parent->m_children.insert(parent->m_children.begin() + ndx, node);
+      try
+      {
+         m_undo.push_back([parent, ndx, node, oldName] {
+            parent->m_children.erase(parent->m_children.begin() + ndx);
+            node->m_name = oldName;
+         });
+      }
+      catch(...)
+      {
+         parent->m_children.erase(parent->m_children.begin() + ndx);
+         throw;
+      }
+      node->m_name = name;
+   }
+
+   std::shared_ptr<JsonNode> DetachChild(const std::shared_ptr<JsonNode> &parent, size_t ndx)
+   {
+      auto node = parent->m_children[ndx];
+      m_undo.push_back([parent, ndx, node] {
+         parent->m_children.insert(parent->m_children.begin() + ndx, node);
+      });
+      parent->m_children.erase(parent->m_children.begin() + ndx);
+      return node;
+   }
+
+   //--------------------------------------------------------------------
+   // Helpers for reading the members of a JSON Patch operation.
+   //--------------------------------------------------------------------
+   static const JsonNode &GetMember(const JsonNode &op, const wchar_t *name)
+   {
+      size_t ndx = IndexOfChildName(op, name);
+      if (ndx == static_cast<size_t>(-1))
+         throw std::wstring(L"JSON Patch operation is missing \"") + name + L"\"";
+      return *op.m_children[ndx];
+   }
+
+   static const std::wstring &GetMemberString(const JsonNode &op, const wchar_t *name)
+   {
+      const JsonNode &member = GetMember(op, name);
+      if (member.m_type != JsonType::String)
+         throw std::wstring(L"JSON Patch operation's \"") + name + L"\" is not a string";
+      return member.m_string;
+   }
+
+   static void GetMemberPointer(const JsonNode &op, const wchar_t *name,
+                                std::vector<std::wstring> &tokens)
+   {
+      if (!SplitJSONPointer(GetMemberString(op, name), tokens))
+         throw std::wstring(L"JSON Patch operation's \"") + name + L"\" is not a valid JSON Pointer";
+   }
+
+   static std::shared_ptr<JsonNode> NewGroup()
+   {
+      auto group = std::make_shared<JsonNode>();
+      group->m_type = JsonType::Group;
+      return group;
+   }
+
+   std::shared_ptr<JsonNode>         &m_root;   // Root of the tree being patched.
+   std::vector<std::function<void()>> m_undo;   // How to undo each change so far.
+};
+
+} // End anon namespace
+
+//--------------------------------------------------------------------
+// Parses JSON text from the given memory buffer.
+// If successful, the root node of the node tree is returned.
+// Errors throw.
+//--------------------------------------------------------------------
+std::shared_ptr<JsonNode> ParseJSONFromMemory(const char *data, size_t size)
+{
+   trace("ParseJSONFromMemory data=%p size=%zu\n", data, size);
+
+   JsonScanner lex;
+   lex.Start(data, size);
+
+   // This does most of the work.
+   return ParseJSONFromScanner(lex);
+}
+
+//--------------------------------------------------------------------
+// Overload of above, takes vector of chars.
+//--------------------------------------------------------------------
+std::shared_ptr<JsonNode> ParseJSONFromMemory(const std::vector<char> &data)
+{
+   if (data.empty())
+      return nullptr;
+
+   return ParseJSONFromMemory(data.data(), data.size());
+}
+
+//--------------------------------------------------------------------
+// Parses JSON text from the specified file.
+// If successful, the root node of the node tree is returned.
+// Errors throw.
+//--------------------------------------------------------------------
+std::shared_ptr<JsonNode> ParseJSONFromFile(const std::wstring &filename)
+{
+   trace(L"ParseJSONFromFile filename='%s'\n", filename.c_str());
+
+   auto source = OpenJSONFile(filename);
+
+   JsonScanner lex;
+   lex.Start(*source);
+
+   // This does most of the work.
+   return ParseJSONFromScanner(lex);
+}
+
+//--------------------------------------------------------------------
+// Parses a list of JSON files and/or memory buffers on a pool of
+// worker threads, handing each result to the callback in input order.
+//--------------------------------------------------------------------
+void ParseJSONBatch(const std::vector<JsonBatchItem> &items,
+                    const JsonBatchOptions &options,
+                    const std::function<void(size_t index, JsonBatchResult &result)> &callback)
+{
+   size_t threads = options.m_threads;
+   if (threads == 0)
+      threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+   threads = std::min(threads, items.size());
+
+   size_t maxInFlight = options.m_maxInFlight;
+   if (maxInFlight == 0)
+      maxInFlight = threads * 2;
+
+   trace("ParseJSONBatch items=%zu threads=%zu maxInFlight=%zu\n",
+         items.size(), threads, maxInFlight);
+
+   if (items.empty())
+      return;
+
+   JsonBatch batch(items, maxInFlight);
+   std::vector<std::thread> workers;
+   try
+   {
+      for (size_t ndx = 0; ndx < threads; ++ndx)
+         workers.emplace_back(&JsonBatch::Worker, &batch);
+
+      batch.Deliver(callback);
+   }
+   catch(...)
+   {
+      batch.Abandon();
+      for (auto &worker : workers)
+         worker.join();
+      throw;
+   }
+
+   for (auto &worker : workers)
+      worker.join();
+}
+
+//--------------------------------------------------------------------
+// Overload of above, returns all of the results in input order.
+//--------------------------------------------------------------------
+std::vector<JsonBatchResult> ParseJSONBatch(const std::vector<JsonBatchItem> &items,
+                                            const JsonBatchOptions &options)
+{
+   std::vector<JsonBatchResult> results(items.size());
+   ParseJSONBatch(items, options, [&results](size_t index, JsonBatchResult &result) {
+      results[index] = std::move(result);
+   });
+   return results;
+}
+
+//--------------------------------------------------------------------
+// Finds a node within a tree of JSON nodes, given a JSON Pointer.
+// Returns null pointer if there is no such node.
+//--------------------------------------------------------------------
+std::shared_ptr<JsonNode> FindNodeByPointer(const std::shared_ptr<JsonNode> &root,
+                                            const std::wstring &pointer)
+{
+   std::vector<std::wstring> tokens;
+   if (!SplitJSONPointer(pointer, tokens))
+      return nullptr;
+
+   auto node = root;
+   for (const auto &token : tokens)
+   {
+      if (!node)
+         break;
+      node = FindChildByToken(*node, token);
+   }
+   return node;
+}
+
+//--------------------------------------------------------------------
+// Extracts fields from an array of group nodes (records) into one
+// contiguous column per field, in a single pass over the records.
+// Errors throw.
+//--------------------------------------------------------------------
+std::vector<JsonColumn> ExtractColumns(const JsonNode &array,
+                                       const std::vector<JsonColumnSpec> &columns)
+{
+   trace(L"ExtractColumns rows=%zu columns=%zu\n", array.m_children.size(), columns.size());
+
+   if (array.m_type != JsonType::Array)
+      throw std::wstring(L"Columns can only be extracted from an array");
+
+   size_t rows = array.m_children.size();
+   std::vector<JsonColumn> result(columns.size());
+   for (size_t col = 0; col < columns.size(); ++col)
+   {
+      JsonColumn &column = result[col];
+      column.m_name = columns[col].m_name;
+      column.m_type = columns[col].m_type;
+      column.m_rows = rows;
+      column.m_nulls.assign((rows + 7) / 8, 0);
+      if (column.m_type == JsonColumnType::Double)
+         column.m_doubles.assign(rows, 0.);
+      else if (column.m_type == JsonColumnType::Int64)
+         column.m_int64s.assign(rows, 0);
+      else
+         column.m_offsets.assign(1, 0);
+   }
+
+   // Remembers which column (if any) the field at each position of the
+   // previous record went to.  Records are usually alike, so this saves
+   // searching the list of column names for most fields.
+   const size_t kNoColumn = static_cast<size_t>(-1);
+   struct FieldGuess { const std::wstring *name; size_t column; };
+   std::vector<FieldGuess> guesses;
+
+   // For each column, the next column asking for the same field (if
+   // any), so that a field requested more than once fills every one.
+   std::vector<size_t> sameName(columns.size(), kNoColumn);
+   for (size_t col = 0; col < columns.size(); ++col)
+   {
+      for (size_t later = col + 1; later < columns.size(); ++later)
+      {
+         if (columns[later].m_name == columns[col].m_name)
+         {
+            sameName[col] = later;
+            break;
+         }
+      }
+   }
+
+   // The field found for each column in the current record.
+   std::vector<const JsonNode *> found(columns.size());
+
+   for (size_t row = 0; row < rows; ++row)
+   {
+      std::fill(found.begin(), found.end(), nullptr);
+
+      const auto &record = array.m_children[row];
+      if (record && record->m_type == JsonType::Group)
+      {
+         for (size_t pos = 0; pos < record->m_children.size(); ++pos)
+         {
+            const JsonNode &field = *record->m_children[pos];
+            if (pos >= guesses.size())
+               guesses.push_back({ nullptr, kNoColumn });
+
+            FieldGuess &guess = guesses[pos];
+            if (guess.name == nullptr || *guess.name != field.m_name)
+            {
+               guess.name = &field.m_name;
+               guess.column = kNoColumn;
+               for (size_t col = 0; col < columns.size(); ++col)
+               {
+                  if (columns[col].m_name == field.m_name)
+                  {
+                     guess.column = col;
+                     break;
+                  }
+               }
+            }
+
+            // Like FindChildByName, the first field with the name wins.
+            for (size_t col = guess.column; col != kNoColumn; col = sameName[col])
+               if (found[col] == nullptr)
+                  found[col] = &field;
+         }
+      }
+
+      // Store this record's value (or null) in each column.
+      for (size_t col = 0; col < columns.size(); ++col)
+      {
+         JsonColumn &column = result[col];
+         const JsonNode *field = found[col];
+         bool isNull = true;
+
+         switch (column.m_type)
+         {
+            case JsonColumnType::Double:
+               if (field != nullptr && field->m_type == JsonType::Number)
+               {
+                  column.m_doubles[row] = field->m_number;
+                  isNull = false;
+               }
+               break;
+            case JsonColumnType::Int64:
+               // The range check also rejects NaN.
+               if (field != nullptr && field->m_type == JsonType::Number &&
+                   field->m_number >= -9223372036854775808.0 &&
+                   field->m_number < 9223372036854775808.0)
+               {
+                  column.m_int64s[row] = static_cast<int64_t>(field->m_number);
+                  isNull = false;
+               }
+               break;
+            case JsonColumnType::String:
+               if (field != nullptr && field->m_type == JsonType::String)
+               {
+                  column.m_chars.insert(column.m_chars.end(),
+                                        field->m_string.begin(), field->m_string.end());
+                  isNull = false;
+               }
+               column.m_offsets.push_back(column.m_chars.size());
+               break;
+         }
+
+         if (isNull)
+            column.m_nulls[row / 8] |= static_cast<uint8_t>(1 << (row % 8));
+      }
+   }
+
+   return result;
+}
+
+//--------------------------------------------------------------------
+// Overload of above, parses the given JSON text and extracts the
+// columns from the array found at the given JSON Pointer.
+// Errors throw.
+//--------------------------------------------------------------------
+std::vector<JsonColumn> ExtractColumns(const char *data, size_t size,
+                                       const std::wstring &pointer,
+                                       const std::vector<JsonColumnSpec> &columns)
+{
+   auto root = ParseJSONFromMemory(data, size);
+   auto array = FindNodeByPointer(root, pointer);
+   if (!array)
+      throw std::wstring(L"No node found at the given JSON Pointer");
+
+   return ExtractColumns(*array, columns);
+}
+
+//--------------------------------------------------------------------
+// Applies a JSON Patch (RFC 6902) to a tree of JSON nodes in place.
+// If any operation fails, all of them are undone.  Errors throw.
+//--------------------------------------------------------------------
+void ApplyJSONPatch(std::shared_ptr<JsonNode> &root, const JsonNode &patch)
+{
+   trace("ApplyJSONPatch operations=%zu\n", patch.m_children.size());
+
+   if (patch.m_type != JsonType::Array)
+      throw std::wstring(L"JSON Patch is not an array of operations");
+
+   JsonPatcher patcher(root);
+   try
+   {
+      for (const auto &op : patch.m_children)
+         patcher.ApplyOperation(*op);
+   }
+   catch(...)
+   {
+      patcher.Rollback();
+      throw;
+   }
+}
+
+//--------------------------------------------------------------------
+// Overload of above, takes the patch as JSON text.
+//--------------------------------------------------------------------
+void ApplyJSONPatch(std::shared_ptr<JsonNode> &root, const char *data, size_t size)
+{
+   auto patch = ParseJSONFromMemory(data, size);
+   if (!patch)
+      throw std::wstring(L"JSON Patch is empty");
+
+   ApplyJSONPatch(root, *patch);
+}
+
+//--------------------------------------------------------------------
+// Applies a JSON Merge Patch (RFC 7396) to a tree of JSON nodes in
+// place.  If it fails, the tree is left unchanged.  Errors throw.
+//--------------------------------------------------------------------
+void ApplyJSONMergePatch(std::shared_ptr<JsonNode> &root, const JsonNode &patch)
+{
+   JsonPatcher patcher(root);
+   try
+   {
+      patcher.ApplyMergePatch(patch);
+   }
+   catch(...)
+   {
+      patcher.Rollback();
+      throw;
+   }
+}
+
+//--------------------------------------------------------------------
+// Overload of above, takes the merge patch as JSON text.
+//--------------------------------------------------------------------
+void ApplyJSONMergePatch(std::shared_ptr<JsonNode> &root, const char *data, size_t size)
+{
+   auto patch = ParseJSONFromMemory(data, size);
+   if (!patch)
+      throw std::wstring(L"JSON Merge Patch is empty");
+
+   ApplyJSONMergePatch(root, *patch);
+}
+
+//--------------------------------------------------------------------
+// Checks whether the given memory buffer holds well-formed JSON text,
+// without building a node tree.  Does not allocate memory or throw.
+//--------------------------------------------------------------------
+JsonValidateResult Validate(const char *data, size_t size, JsonSyntax syntax)
+{
+   trace("Validate data=%p size=%zu\n", data, size);
+
+   JsonValidator validator(data, size, syntax);
+   return validator.Run();
 }
 
 } // End namespace njson
@@ -37,9 +37,11 @@
 //--------------------------------------------------------------------
 
 #pragma once
+#include <stdint.h>
 #include <string>
 #include <vector>
 #include <memory>
+#include <functional>
 
 namespace njson
 {
@@ -93,7 +95,191 @@ std::shared_ptr<JsonNode> ParseJSONFromMemory(const std::vector<char> &data);
 // Parses JSON text from the specified file.
 // If successful, the root node of the node tree is returned.
 // Errors throw.
+//
+// Files that are gzip or zstd compressed are decompressed on the fly
+// if support for that format was enabled at build time (see the
+// NOMJSON_USE_ZLIB and NOMJSON_USE_ZSTD defines).
 //--------------------------------------------------------------------
 std::shared_ptr<JsonNode> ParseJSONFromFile(const std::wstring &filename);
 
+//--------------------------------------------------------------------
+// One input to ParseJSONBatch:  either the name of a JSON file, or
+// a memory buffer holding JSON text.  A buffer must remain valid
+// until the batch has finished.
+//--------------------------------------------------------------------
+class JsonBatchItem
+{
+public:
+   std::wstring m_filename;         // If not empty, the file to parse.
+   const char  *m_data = nullptr;   // Otherwise, the JSON text to parse.
+   size_t       m_size = 0;         // Size of m_data in bytes.
+};
+
+//--------------------------------------------------------------------
+// The outcome of parsing one JsonBatchItem.
+//--------------------------------------------------------------------
+class JsonBatchResult
+{
+public:
+   std::shared_ptr<JsonNode> m_root;   // Root node if successful, else null.
+   std::wstring              m_error;  // Error message if parsing failed.
+};
+
+//--------------------------------------------------------------------
+// Settings for ParseJSONBatch.
+//--------------------------------------------------------------------
+class JsonBatchOptions
+{
+public:
+   // Number of worker threads.  Zero means one per CPU core.
+   size_t m_threads = 0;
+
+   // Maximum number of documents that may be loaded, parsing, or
+   // parsed but not yet handed to the caller at any one time.
+   // Zero means twice the number of threads.
+   size_t m_maxInFlight = 0;
+};
+
+//--------------------------------------------------------------------
+// Parses a list of JSON files and/or memory buffers on a pool of
+// worker threads.  Each worker reuses its own scanner buffers from
+// one document to the next.
+//
+// The first form hands each result to the callback, on the calling
+// thread and in input order, as soon as it and all of the results
+// before it are ready.  The second form returns all of the results,
+// in input order.  An error in one item does not stop the others;
+// it is reported in that item's m_error.  If the callback throws,
+// the batch is abandoned and the exception propagates.
+//--------------------------------------------------------------------
+void ParseJSONBatch(const std::vector<JsonBatchItem> &items,
+                    const JsonBatchOptions &options,
+                    const std::function<void(size_t index, JsonBatchResult &result)> &callback);
+std::vector<JsonBatchResult> ParseJSONBatch(const std::vector<JsonBatchItem> &items,
+                                            const JsonBatchOptions &options = JsonBatchOptions());
+
+//--------------------------------------------------------------------
+// Finds a node within a tree of JSON nodes, given a JSON Pointer
+// (RFC 6901) such as L"/results/0/code".  Each step names a child of
+// a group, or gives the zero-based index of an element of an array.
+// An empty pointer refers to the root itself.  Returns null pointer
+// if there is no such node.
+//--------------------------------------------------------------------
+std::shared_ptr<JsonNode> FindNodeByPointer(const std::shared_ptr<JsonNode> &root,
+                                            const std::wstring &pointer);
+
+//--------------------------------------------------------------------
+// IDs for the kinds of columns that ExtractColumns can produce.
+//--------------------------------------------------------------------
+enum class JsonColumnType { Double, Int64, String };
+
+//--------------------------------------------------------------------
+// Describes one column for ExtractColumns to produce:  the name of
+// the field to take from each record, and how to store its values.
+//--------------------------------------------------------------------
+class JsonColumnSpec
+{
+public:
+   std::wstring   m_name;                          // Name of the field.
+   JsonColumnType m_type = JsonColumnType::Double; // How to store the values.
+};
+
+//--------------------------------------------------------------------
+// One column of values extracted from an array of records, with one
+// row per record.  Only the vectors for m_type are filled in.
+//
+// A row is null if the record lacks the field, the field is of the
+// wrong JSON type (a number for Double and Int64 columns, a string
+// for String columns), or the number is out of range for Int64.
+// Null rows hold 0 or an empty string.
+//--------------------------------------------------------------------
+class JsonColumn
+{
+public:
+   std::wstring         m_name;                          // Name of the field.
+   JsonColumnType       m_type = JsonColumnType::Double; // Kind of values.
+   size_t               m_rows = 0;                      // Number of rows.
+   std::vector<double>  m_doubles;   // Values when m_type is Double.
+   std::vector<int64_t> m_int64s;    // Values when m_type is Int64 (truncated toward zero).
+   std::vector<size_t>  m_offsets;   // When m_type is String, row N's text is
+   std::vector<wchar_t> m_chars;     // m_chars[m_offsets[N]] to m_chars[m_offsets[N+1]].
+   std::vector<uint8_t> m_nulls;     // Bit (N % 8) of byte (N / 8) is set if row N is null.
+
+   // Returns true if the given row is null.
+   bool IsNull(size_t row) const { return (m_nulls[row / 8] & (1 << (row % 8))) != 0; }
+
+   // Returns the text of the given row of a String column.
+   std::wstring GetString(size_t row) const
+   {
+      return std::wstring(m_chars.data() + m_offsets[row], m_chars.data() + m_offsets[row + 1]);
+   }
+};
+
+//--------------------------------------------------------------------
+// Extracts fields from an array of group nodes (records) into one
+// contiguous column per field, in a single pass over the records.
+// The same field may be requested more than once, e.g. as both a
+// Double and an Int64 column.
+// The second form parses the given JSON text first, then finds the
+// array with the given JSON Pointer (see FindNodeByPointer).
+// Errors throw.
+//--------------------------------------------------------------------
+std::vector<JsonColumn> ExtractColumns(const JsonNode &array,
+                                       const std::vector<JsonColumnSpec> &columns);
+std::vector<JsonColumn> ExtractColumns(const char *data, size_t size,
+                                       const std::wstring &pointer,
+                                       const std::vector<JsonColumnSpec> &columns);
+
+//--------------------------------------------------------------------
+// Applies a JSON Patch (RFC 6902) to a tree of JSON nodes in place.
+// The patch is an array of add, remove, replace, move, copy, and test
+// operations, given either as a parsed node or as JSON text.  The
+// root may be replaced by an operation whose path is the root.
+//
+// The operations are all-or-nothing:  if any of them fails, the
+// changes made by the earlier ones are undone, and then the error is
+// thrown.  Only the nodes named by the patch are visited, so the cost
+// depends on the size of the patch rather than of the tree.
+//--------------------------------------------------------------------
+void ApplyJSONPatch(std::shared_ptr<JsonNode> &root, const JsonNode &patch);
+void ApplyJSONPatch(std::shared_ptr<JsonNode> &root, const char *data, size_t size);
+
+//--------------------------------------------------------------------
+// Applies a JSON Merge Patch (RFC 7396) to a tree of JSON nodes in
+// place, given either as a parsed node or as JSON text.  Like
+// ApplyJSONPatch, this is all-or-nothing.  Errors throw.
+//--------------------------------------------------------------------
+void ApplyJSONMergePatch(std::shared_ptr<JsonNode> &root, const JsonNode &patch);
+void ApplyJSONMergePatch(std::shared_ptr<JsonNode> &root, const char *data, size_t size);
+
+//--------------------------------------------------------------------
+// Selects how strictly Validate() checks JSON text.
+//   Strict:   Only text that conforms to RFC 8259 is accepted.
+//   Lenient:  Also accepts what the parser tolerates:  missing commas
+//             between elements, a trailing comma after the last
+//             element, single-quoted strings, and JSONP wrappers.
+//--------------------------------------------------------------------
+enum class JsonSyntax { Strict, Lenient };
+
+//--------------------------------------------------------------------
+// Result of checking JSON text with Validate().
+//--------------------------------------------------------------------
+class JsonValidateResult
+{
+public:
+   bool           m_valid = true;     // True if the text is valid JSON.
+   const wchar_t *m_error = nullptr;  // If not valid, describes the problem.
+   size_t         m_offset = 0;       // If not valid, byte offset of the problem.
+   size_t         m_line = 0;         // If not valid, line number of the problem (1-based).
+   size_t         m_column = 0;       // If not valid, column of the problem in bytes (1-based).
+};
+
+//--------------------------------------------------------------------
+// Checks whether the given memory buffer holds well-formed JSON text,
+// including string escapes, UTF-8 encoding, and number syntax,
+// without building a node tree.  Does not allocate memory or throw.
+//--------------------------------------------------------------------
+JsonValidateResult Validate(const char *data, size_t size,
+                            JsonSyntax syntax = JsonSyntax::Lenient);
+
 } // End namespace njson
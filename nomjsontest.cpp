@@ -43,9 +43,49 @@
 #include <stdio.h>
 #include <string.h>
 #include <memory>
+#include <vector>
 
 namespace {
 
+//--------------------------------------------------------------------
+// Reads the entire contents of the specified file into memory.
+// Errors throw.
+//--------------------------------------------------------------------
+std::vector<char> ReadFileToMemory(const wchar_t *filename)
+{
+   FILE *file = nullptr;
+   if (_wfopen_s(&file, filename, L"rb") || file == nullptr)
+      throw std::wstring(L"File could not be opened for reading");
+
+   std::vector<char> data;
+   char buffer[4096];
+   size_t count;
+   while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+      data.insert(data.end(), buffer, buffer + count);
+   fclose(file);
+
+   return data;
+}
+
+//--------------------------------------------------------------------
+// Checks the given JSON file with njson::Validate and reports the
+// outcome to the console.  Returns true if the file is valid.
+//--------------------------------------------------------------------
+bool ValidateJsonFile(const wchar_t *filename, njson::JsonSyntax syntax)
+{
+   auto data = ReadFileToMemory(filename);
+   auto result = njson::Validate(data.data(), data.size(), syntax);
+   if (!result.m_valid)
+   {
+      wprintf(L"Invalid JSON at offset %zu (line %zu, column %zu):\n%s\n",
+              result.m_offset, result.m_line, result.m_column, result.m_error);
+      return false;
+   }
+
+   wprintf(L"Valid JSON.\n");
+   return true;
+}
+
 //--------------------------------------------------------------------
 // Displays the contents of the given JSON node (and its children)
 // to the console.
@@ -109,6 +149,116 @@ void DumpJsonNode(const std::shared_ptr<njson::JsonNode> &node, size_t indent)
    }
 }
 
+//--------------------------------------------------------------------
+// Parses the given JSON files with njson::ParseJSONBatch and dumps
+// each one to the console, in order.  Returns true if all of the
+// files were parsed successfully.
+//--------------------------------------------------------------------
+bool DumpJsonFileBatch(int count, wchar_t **filenames)
+{
+   std::vector<njson::JsonBatchItem> items(count);
+   for (int ndx = 0; ndx < count; ++ndx)
+      items[ndx].m_filename = filenames[ndx];
+
+   bool success = true;
+   njson::ParseJSONBatch(items, njson::JsonBatchOptions(),
+      [&](size_t index, njson::JsonBatchResult &result)
+      {
+         wprintf(L"File %s:\n", items[index].m_filename.c_str());
+         if (!result.m_error.empty())
+         {
+            wprintf(L"Failed due to error:\n%s\n", result.m_error.c_str());
+            success = false;
+         }
+         DumpJsonNode(result.m_root, 0);
+      });
+
+   return success;
+}
+
+//--------------------------------------------------------------------
+// Extracts columns from the array at the given JSON Pointer in the
+// given JSON file with njson::ExtractColumns, and dumps them to the
+// console.  Each column is given as "name:type", where the type is
+// double, int64, or string.  Errors throw.
+//--------------------------------------------------------------------
+void DumpJsonFileColumns(const wchar_t *filename, const wchar_t *pointer,
+                         int count, wchar_t **fields)
+{
+   std::vector<njson::JsonColumnSpec> specs(count);
+   for (int ndx = 0; ndx < count; ++ndx)
+   {
+      std::wstring field = fields[ndx];
+      size_t colon = field.rfind(L':');
+      std::wstring type = (colon == std::wstring::npos) ? L"" : field.substr(colon + 1);
+      specs[ndx].m_name = field.substr(0, colon);
+      if (type == L"double")
+         specs[ndx].m_type = njson::JsonColumnType::Double;
+      else if (type == L"int64")
+         specs[ndx].m_type = njson::JsonColumnType::Int64;
+      else if (type == L"string")
+         specs[ndx].m_type = njson::JsonColumnType::String;
+      else
+         throw std::wstring(L"Column must be given as name:double, name:int64, or name:string");
+   }
+
+   auto data = ReadFileToMemory(filename);
+   auto columns = njson::ExtractColumns(data.data(), data.size(), pointer, specs);
+
+   for (size_t ndx = 0; ndx < columns.size(); ++ndx)
+   {
+      const auto &column = columns[ndx];
+      size_t nulls = 0;
+      for (size_t row = 0; row < column.m_rows; ++row)
+         if (column.IsNull(row))
+            ++nulls;
+
+      wprintf(L"Column %s:  %zu rows, %zu null\n  ", fields[ndx], column.m_rows, nulls);
+      for (size_t row = 0; row < column.m_rows; ++row)
+      {
+         if (column.IsNull(row))
+            wprintf(L" null");
+         else if (column.m_type == njson::JsonColumnType::Double)
+            wprintf(L" %G", column.m_doubles[row]);
+         else if (column.m_type == njson::JsonColumnType::Int64)
+            wprintf(L" %lld", static_cast<long long>(column.m_int64s[row]));
+         else
+            wprintf(L" \"%s\"", column.GetString(row).c_str());
+      }
+      wprintf(L"\n");
+   }
+}
+
+//--------------------------------------------------------------------
+// Parses the given JSON file, applies the given JSON Patch (or JSON
+// Merge Patch) file to it, and dumps the result to the console.  If
+// the patch fails, the error goes to stderr, so that the dump of the
+// unchanged tree can be compared with that of the original file.
+// Returns true if the patch succeeded.
+//--------------------------------------------------------------------
+bool DumpPatchedJsonFile(const wchar_t *filename, const wchar_t *patchFilename, bool merge)
+{
+   auto rootNode = njson::ParseJSONFromFile(filename);
+   auto patch = ReadFileToMemory(patchFilename);
+
+   bool success = true;
+   try
+   {
+      if (merge)
+         njson::ApplyJSONMergePatch(rootNode, patch.data(), patch.size());
+      else
+         njson::ApplyJSONPatch(rootNode, patch.data(), patch.size());
+   }
+   catch(const std::wstring &exc)
+   {
+      fwprintf(stderr, L"Patch failed due to error:\n%s\n", exc.c_str());
+      success = false;
+   }
+
+   DumpJsonNode(rootNode, 0);
+   return success;
+}
+
 } // End anon namespace
 
 //--------------------------------------------------------------------
@@ -118,15 +268,49 @@ void DumpJsonNode(const std::shared_ptr<njson::JsonNode> &node, size_t indent)
 int
 wmain(int argc, wchar_t **argv)
 {
-   if (argc != 2)
+   // With no option, the file is parsed with ParseJSONFromFile and
+   // dumped.  The options exercise the other NomJSON APIs:
+   //   -memory     Parses the file with ParseJSONFromMemory instead.
+   //   -validate   Checks the file with Validate, in lenient mode.
+   //   -strict     Checks the file with Validate, in strict mode.
+   //   -batch      Parses any number of files with ParseJSONBatch.
+   //   -columns    Extracts columns from an array with ExtractColumns.
+   //   -patch      Applies a patch file with ApplyJSONPatch.
+   //   -mergepatch Applies a patch file with ApplyJSONMergePatch.
+   std::wstring option = (argc >= 3) ? argv[1] : L"";
+   bool oneFile = (option == L"-memory" || option == L"-validate" || option == L"-strict");
+   bool twoFiles = (option == L"-patch" || option == L"-mergepatch");
+   if (!(argc == 2 || (argc == 3 && oneFile) || (argc == 4 && twoFiles) ||
+         (argc >= 3 && option == L"-batch") || (argc >= 5 && option == L"-columns")))
    {
-      wprintf(L"Usage:  nomjsontest filename.json\n");
+      wprintf(L"Usage:  nomjsontest [-memory | -validate | -strict] filename.json\n"
+              L"        nomjsontest -batch filename.json [filename.json ...]\n"
+              L"        nomjsontest -columns filename.json /pointer name:type [name:type ...]\n"
+              L"        nomjsontest [-patch | -mergepatch] filename.json patch.json\n");
       return EXIT_FAILURE;
    }
 
    try
    {
-      auto rootNode = njson::ParseJSONFromFile(argv[1]);
+      if (option == L"-validate")
+         return ValidateJsonFile(argv[2], njson::JsonSyntax::Lenient) ? EXIT_SUCCESS : EXIT_FAILURE;
+      if (option == L"-strict")
+         return ValidateJsonFile(argv[2], njson::JsonSyntax::Strict) ? EXIT_SUCCESS : EXIT_FAILURE;
+      if (option == L"-batch")
+         return DumpJsonFileBatch(argc - 2, argv + 2) ? EXIT_SUCCESS : EXIT_FAILURE;
+      if (option == L"-columns")
+      {
+         DumpJsonFileColumns(argv[2], argv[3], argc - 4, argv + 4);
+         return EXIT_SUCCESS;
+      }
+      if (twoFiles)
+         return DumpPatchedJsonFile(argv[2], argv[3], option == L"-mergepatch") ? EXIT_SUCCESS : EXIT_FAILURE;
+
+      std::shared_ptr<njson::JsonNode> rootNode;
+      if (option == L"-memory")
+         rootNode = njson::ParseJSONFromMemory(ReadFileToMemory(argv[2]));
+      else
+         rootNode = njson::ParseJSONFromFile(argv[1]);
       DumpJsonNode(rootNode, 0);
    }
    catch(const std::wstring &exc)
@@ -9,6 +9,118 @@ echo Running tests.  This may take a minute.
 bin\nomjsontest.exe ref\epsg_io_json_output.txt >> err
 if errorlevel 1 goto fail
 
+rem Parsing a file must give the same result as parsing it from memory,
+rem including a file large enough to be streamed in several chunks.
+bin\nomjsontest.exe ref\large_string.json > __out1.out
+if errorlevel 1 goto fail
+bin\nomjsontest.exe -memory ref\large_string.json > __out2.out
+if errorlevel 1 goto fail
+fc /b __out1.out __out2.out > nul
+if errorlevel 1 goto fail
+
+rem Compressed files are only supported when built with ZLIB=1, so
+rem set ZLIB=1 when running the tests against such a build, too.
+if not "%ZLIB%"=="1" goto skipgzip
+bin\nomjsontest.exe ref\large_string.json.gz > __out3.out
+if errorlevel 1 goto fail
+fc /b __out1.out __out3.out > nul
+if errorlevel 1 goto fail
+bin\nomjsontest.exe ref\epsg_io_json_output.txt > __out1.out
+if errorlevel 1 goto fail
+bin\nomjsontest.exe ref\epsg_io_json_output.txt.gz > __out2.out
+if errorlevel 1 goto fail
+fc /b __out1.out __out2.out > nul
+if errorlevel 1 goto fail
+:skipgzip
+
+bin\nomjsontest.exe -validate ref\epsg_io_json_output.txt >> err
+if errorlevel 1 goto fail
+
+rem Strict mode must reject the JSONP wrapper that lenient mode accepts.
+bin\nomjsontest.exe -strict ref\epsg_io_json_output.txt > __out1.out
+if not errorlevel 1 goto fail
+
+rem Both modes must reject ref\invalid.json, each at the right place:
+rem strict at the trailing comma, lenient at the leading zero.
+bin\nomjsontest.exe -strict ref\invalid.json > __out1.out
+if not errorlevel 1 goto fail
+findstr /C:"offset 16 (line 2, column 15)" __out1.out > nul
+if errorlevel 1 goto fail
+bin\nomjsontest.exe -validate ref\invalid.json > __out1.out
+if not errorlevel 1 goto fail
+findstr /C:"offset 28 (line 3, column 10)" __out1.out > nul
+if errorlevel 1 goto fail
+
+bin\nomjsontest.exe -batch ref\epsg_io_json_output.txt ref\epsg_io_json_output.txt >> err
+if errorlevel 1 goto fail
+
+rem A batch with a missing file and a blank file must fail, but must
+rem still report every item in input order, and each good file's dump
+rem must match that of parsing it alone.
+bin\nomjsontest.exe ref\epsg_io_json_output.txt > __out1.out
+if errorlevel 1 goto fail
+echo File ref\epsg_io_json_output.txt:> __out2.out
+type __out1.out >> __out2.out
+echo File ref\nosuch.json:>> __out2.out
+echo Failed due to error:>> __out2.out
+echo File could not be opened for reading>> __out2.out
+echo File ref\blank.json:>> __out2.out
+echo Failed due to error:>> __out2.out
+echo Input is empty>> __out2.out
+echo File ref\epsg_io_json_output.txt:>> __out2.out
+type __out1.out >> __out2.out
+bin\nomjsontest.exe -batch ref\epsg_io_json_output.txt ref\nosuch.json ref\blank.json ref\epsg_io_json_output.txt > __out3.out
+if not errorlevel 1 goto fail
+fc /b __out2.out __out3.out > nul
+if errorlevel 1 goto fail
+
+rem Extract columns from the array of records.  The code is requested
+rem twice, as both types.  "bbox" is an array rather than a number, and
+rem "nosuch" is missing, so both of those columns must be all null.
+bin\nomjsontest.exe -columns ref\epsg_io_json_output.txt /results code:int64 code:double kind:string bbox:double nosuch:string > __out1.out
+if errorlevel 1 goto fail
+type __out1.out >> err
+findstr /C:"Column code:int64:  10 rows, 0 null" __out1.out > nul
+if errorlevel 1 goto fail
+findstr /C:"Column code:double:  10 rows, 0 null" __out1.out > nul
+if errorlevel 1 goto fail
+findstr /C:"Column kind:string:  10 rows, 0 null" __out1.out > nul
+if errorlevel 1 goto fail
+findstr /C:"Column bbox:double:  10 rows, 10 null" __out1.out > nul
+if errorlevel 1 goto fail
+findstr /C:"Column nosuch:string:  10 rows, 10 null" __out1.out > nul
+if errorlevel 1 goto fail
+
+rem A patch whose test operations all pass must succeed.
+bin\nomjsontest.exe -patch ref\epsg_io_json_output.txt ref\patch_ok.json > __out1.out
+if errorlevel 1 goto fail
+
+rem A patch whose last test fails must leave the tree unchanged.
+bin\nomjsontest.exe ref\epsg_io_json_output.txt > __out1.out
+if errorlevel 1 goto fail
+bin\nomjsontest.exe -patch ref\epsg_io_json_output.txt ref\patch_fail.json > __out2.out 2> nul
+if not errorlevel 1 goto fail
+fc /b __out1.out __out2.out > nul
+if errorlevel 1 goto fail
+
+rem Replacing the root must leave it unnamed.
+bin\nomjsontest.exe -patch ref\epsg_io_json_output.txt ref\patch_root.json > __out1.out
+if errorlevel 1 goto fail
+findstr /B /C:"(unnamed):  group  {1 elements}:" __out1.out > nul
+if errorlevel 1 goto fail
+
+rem A merge patch removes "status", replaces "number_result", and adds
+rem "extra" without its null member.
+bin\nomjsontest.exe -mergepatch ref\epsg_io_json_output.txt ref\mergepatch.json > __out1.out
+if errorlevel 1 goto fail
+findstr /C:"  status:" __out1.out > nul
+if not errorlevel 1 goto fail
+findstr /C:"number_result:  number:  42" __out1.out > nul
+if errorlevel 1 goto fail
+findstr /C:"extra:  group  {1 elements}:" __out1.out > nul
+if errorlevel 1 goto fail
+
+if exist __out*.out del __out*.out
 if exist err type err
 echo Done.
 exit /b 0